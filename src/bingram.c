@@ -15,11 +15,12 @@
 #include <getopt.h>
 #include <limits.h>
 #include <dirent.h>
+#include <math.h>
 #include "../config.h"
 #include "bingram.h"
 #include "json.h"
 
-#define GRAM2JSON(g) do {\
+#define GRAM2JSON(g, jobj_est) do {\
         if(g->buf)\
         {\
             json_object *jobj_gram = json_object_new_object();\
@@ -29,6 +30,13 @@
             json_object_object_add(jobj_params, "addr", json_object_new_int(g->addr));\
             json_object_object_add(jobj_params, "offs", json_object_new_int(g->offs));\
             json_object_object_add(jobj_params, "cnt", json_object_new_int(g->count));\
+            if(g->files.n)\
+                json_object_object_add(jobj_params, "sup", json_object_new_int(bg_bitmap_card(&g->files)));\
+            {\
+                json_object *jobj_e = (jobj_est);\
+                if(jobj_e)\
+                    json_object_object_add(jobj_params, "est", jobj_e);\
+            }\
             json_object_object_add(jobj_gram, gramdata, jobj_params);\
             json_object_array_add(jarr_gram, jobj_gram);\
         }\
@@ -43,9 +51,14 @@ void usage(char *cmdname)
     fprintf(stderr, "\t -s,--strings\tprocess \"strings\" command output (alphanumeric) files\n");
     fprintf(stderr, "\t -i,--histogram\tsummary most common bytes found across files\n");
     fprintf(stderr, "\t -g,--gramsize\tminimum size of a gram used in comparisons\n");
+    fprintf(stderr, "\t -x,--maximal\tonly report maximal grams of each file pair\n");
     fprintf(stderr, "\t -j,--jsonpretty\tpretty print of json output (default is plain)\n");
     fprintf(stderr, "\t -b,--buffersize\tchange max size for a file (default %d bytes)\n", BG_DEFAULT_BUFFERSIZE);
-    fprintf(stderr, "\t -f,--maxfiles\tprocess up to maxfiles (default %d)\n\n", BG_DEFAULT_MAXFILES);
+    fprintf(stderr, "\t -f,--maxfiles\tprocess up to maxfiles (default %d)\n", BG_DEFAULT_MAXFILES);
+    fprintf(stderr, "\t -m,--min-support\tonly keep grams found in at least N files, or N%% of files (default off)\n");
+    fprintf(stderr, "\t -r,--sample-pairs\tonly match R randomly sampled file pairs, report estimates (default off)\n");
+    fprintf(stderr, "\t -n,--sample-files\tonly load N randomly sampled files, report estimates (default off)\n");
+    fprintf(stderr, "\t -d,--seed\tseed used for sampling (default %d)\n\n", BG_DEFAULT_SEED);
     fprintf(stderr, "\t -e,--editdist\tchange edit distance subtraction tolerance (default %d, max %d)\n", 
                                                                                       BG_DEFAULT_EDITDIST,
                                                                                       BG_LIMIT_EDITDIST);
@@ -59,10 +72,15 @@ int main(int argc, char **argv)
     int bg_mem_maxfiles = BG_DEFAULT_MAXFILES;
     int bg_mem_gramsize = BG_DEFAULT_GRAMSIZE;
     int bg_mem_editdist = BG_DEFAULT_EDITDIST;
+    int bg_mem_minsupport = 0;
+    int bg_mem_minsupport_pct = 0;
+    int bg_mem_samplepairs = 0;
+    int bg_mem_samplefiles = 0;
+    unsigned int bg_mem_seed = BG_DEFAULT_SEED;
     opt_mask_t opt_mask = MODE_DEFAULT;  // Default set
     int option_index=0;
 
-    bg_mem_t bg_mem;
+    bg_mem_t *bg_mem;
     
     static struct option long_options[] =
     {
@@ -71,13 +89,18 @@ int main(int argc, char **argv)
         {"strings",   no_argument,      0, 's'},
         {"histogram", no_argument,      0, 'i'},
         {"jsonpretty",no_argument,      0, 'j'},
+        {"maximal",   no_argument,      0, 'x'},
         {"gramsize",  required_argument,0, 'g'},
         {"buffersize",required_argument,0, 'b'},
         {"maxfiles",  required_argument,0, 'f'},
+        {"min-support",required_argument,0, 'm'},
+        {"sample-pairs",required_argument,0, 'r'},
+        {"sample-files",required_argument,0, 'n'},
+        {"seed",      required_argument,0, 'd'},
         {0, 0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "jivsce:g:b:f:",
+    while ((opt = getopt_long(argc, argv, "jivsxce:g:b:f:m:r:n:d:",
                       long_options, &option_index)) != -1)
     {
         switch (opt)
@@ -95,6 +118,7 @@ int main(int argc, char **argv)
         case 'v': opt_mask|=MODE_VERBOSE; break;
         case 'i': opt_mask|=MODE_BYTECNT; break;
         case 'j': opt_mask|=MODE_JSONPTY; break;
+        case 'x': opt_mask|=MODE_MAXIMAL; break;
         case 'g':
             bg_mem_gramsize=atoi(optarg);
             if(bg_mem_gramsize>0 && bg_mem_gramsize<bg_mem_buffersize)
@@ -139,6 +163,52 @@ int main(int argc, char **argv)
             DPRINT(("arg %s\n", optarg), 1);
             //printf
             break;
+        case 'm':
+            bg_mem_minsupport=atoi(optarg);
+            if(strchr(optarg, '%'))
+            {
+                if(bg_mem_minsupport>0 && bg_mem_minsupport<=100)
+                    printf("Keeping grams found in at least [%d%%] of files\n", bg_mem_minsupport);
+                else
+                {
+                    fprintf(stderr, "main: invalid min-support, try any percentage between 1%% to 100%%\n");
+                    return 1;
+                }
+                bg_mem_minsupport_pct=bg_mem_minsupport;
+                bg_mem_minsupport=0;
+            }
+            else if(bg_mem_minsupport>0 && bg_mem_minsupport<BG_LIMIT_MAXFILES)
+                printf("Keeping grams found in at least [%d] files\n", bg_mem_minsupport);
+            else
+            {
+                fprintf(stderr, "main: invalid min-support, try any positive integer between 0 to %d\n", BG_LIMIT_MAXFILES);
+                return 1;
+            }
+            break;
+        case 'r':
+            bg_mem_samplepairs=atoi(optarg);
+            if(bg_mem_samplepairs>0 && bg_mem_samplepairs<BG_LIMIT_SAMPLEPAIRS)
+                printf("Sampling up to [%d] file pairs\n", bg_mem_samplepairs);
+            else
+            {
+                fprintf(stderr, "main: invalid sample-pairs, try any positive integer between 0 to %d\n", BG_LIMIT_SAMPLEPAIRS);
+                return 1;
+            }
+            break;
+        case 'n':
+            bg_mem_samplefiles=atoi(optarg);
+            if(bg_mem_samplefiles>1 && bg_mem_samplefiles<BG_LIMIT_MAXFILES)
+                printf("Sampling up to [%d] files\n", bg_mem_samplefiles);
+            else
+            {
+                fprintf(stderr, "main: invalid sample-files, try any positive integer between 1 to %d\n", BG_LIMIT_MAXFILES);
+                return 1;
+            }
+            break;
+        case 'd':
+            bg_mem_seed=(unsigned int)strtoul(optarg, NULL, 0);
+            DPRINT(("arg %s\n", optarg), 1);
+            break;
 
 
         default:
@@ -148,6 +218,15 @@ int main(int argc, char **argv)
 
     DPRINT(("verbose mode on \n"), opt_mask);
 
+    if(bg_mem_samplepairs && bg_mem_samplefiles)
+    {
+        fprintf(stderr, "main: sample-pairs and sample-files can't be used together\n");
+        return 1;
+    }
+    //the file reservoir is the file table itself
+    if(bg_mem_samplefiles)
+        bg_mem_maxfiles=bg_mem_samplefiles;
+
     /* Process file names or stdin */
     if (optind >= argc)
     {
@@ -158,17 +237,31 @@ int main(int argc, char **argv)
     {
         int i;
 
-        bg_mem_init(&bg_mem, opt_mask, bg_mem_maxfiles, bg_mem_buffersize, bg_mem_gramsize);
+        //gram table is several MB, keep it off the stack
+        bg_mem=(bg_mem_t *)malloc(sizeof(bg_mem_t));
+        if(!bg_mem)
+        {
+            fprintf(stderr, "main: malloc failed\n");
+            return 1;
+        }
+        bg_mem_init(bg_mem, opt_mask, bg_mem_maxfiles, bg_mem_buffersize, bg_mem_gramsize);
+        bg_mem->minsupport=bg_mem_minsupport;
+        bg_mem->minsupport_pct=bg_mem_minsupport_pct;
+        bg_mem->sample_pairs=bg_mem_samplepairs;
+        bg_mem->sample_files=bg_mem_samplefiles;
+        bg_mem->seed=bg_mem_seed;
+        bg_mem->rng=bg_mem_seed;
 
         for (i = optind; i < argc; i++)
         {
-            bg_mem_addfile(&bg_mem, argv[i]);
+            bg_mem_addfile(bg_mem, argv[i]);
         }
 
-        bg_mem_process(&bg_mem);
-        bg_mem_show(&bg_mem);
+        bg_mem_process(bg_mem);
+        bg_mem_show(bg_mem);
+        bg_mem_close(bg_mem);
+        free(bg_mem);
     }
-    bg_mem_close(&bg_mem);
     return 0;
 }
 
@@ -202,48 +295,61 @@ int bg_mem_addfile(bg_mem_t *bg_mem, char *filename)
         DPRINT(("loading dir %s ...\n", filename), bg_mem->opt_mask);
         if ((dir = opendir (filename)) != NULL) 
         {
-            int ret=1;
             while ((ent = readdir (dir)) != NULL) 
             if(ent->d_name[0]!='.')
             {
                 snprintf(fullpath, BG_LIMIT_FULLPATH, "%s/%s", filename, ent->d_name);
                 DPRINT(("%s\n", fullpath), bg_mem->opt_mask);
-                ret=bg_mem_addfile(bg_mem, fullpath);
+                bg_mem_addfile(bg_mem, fullpath);
             }
-            if(!ret) closedir(dir);
+            closedir(dir);
         }
     }
     else if( st.st_mode & S_IFREG )
     {
-        FILE *fp = fopen(filename, "r");
-        if (fp == 0)
-            fprintf(stderr, "bg_mem_addfile: failed to open %s (%d %s)\n",
-                                         filename, errno, strerror(errno));
-        else
+        bg_file_t *bg_file;
+        int slot=bg_mem->ind;
+        if(bg_mem->sample_pairs)
         {
-            bg_file_t *bg_file;
-            bg_file = (bg_file_t *)malloc(sizeof(bg_file_t));
-            if(!bg_file)
-            {
-                fprintf(stderr, "main: malloc failed\n");
-                return 1;
-            }
-            DPRINT(("loading file %s ...\n", filename), bg_mem->opt_mask);
-            bg_file_init(bg_file,fp, filename, bg_mem->opt_mask);
-            if((bg_file->size > 0) && (bg_file->size <= bg_mem->buffersize))
-            {
-                if( bg_mem->ind <= bg_mem->maxfiles )
-                    bg_mem->bg_file[bg_mem->ind++]=bg_file;
-            }
-            else
+            //only note the file, the sampled pairs decide what gets loaded
+            if((st.st_size > 0) && (st.st_size <= bg_mem->buffersize))
+                return bg_mem_addpath(bg_mem, filename);
+            fprintf(stderr, "main: Warning! invalid file(%s) size of %d, allowed: %d. Check -b option.\n",
+                filename,
+                (int)st.st_size,
+                bg_mem->buffersize);
+            return 1;
+        }
+        if(bg_mem->sample_files && (st.st_size > 0) && (st.st_size <= bg_mem->buffersize))
+        {
+            //reservoir sampling, decided before the file is read
+            bg_mem->seen++;
+            if(bg_mem->ind >= bg_mem->sample_files)
             {
-                fprintf(stderr, "main: Warning! invalid file(%s) size of %d, allowed: %d. Check -b option.\n", 
-                    bg_file->filename,
-                    bg_file->size, 
-                    bg_mem->buffersize);
-                return 1;
+                slot=(int)(bg_rand(bg_mem) % bg_mem->seen);
+                if(slot >= bg_mem->sample_files)
+                {
+                    DPRINT(("skipping file %s (not sampled)\n", filename), bg_mem->opt_mask);
+                    return 0;
+                }
             }
-            fclose(fp);
+        }
+        bg_file=bg_mem_loadfile(bg_mem, filename);
+        if(!bg_file) return 1;
+        if( slot < bg_mem->ind )
+        {
+            bg_file_close(bg_mem->bg_file[slot]);
+            bg_mem->bg_file[slot]=bg_file;
+        }
+        else if( bg_mem->ind < bg_mem->maxfiles )
+            bg_mem->bg_file[bg_mem->ind++]=bg_file;
+        else
+        {
+            fprintf(stderr, "main: Warning! more than %d files, skipping %s. Check -f option.\n",
+                bg_mem->maxfiles,
+                filename);
+            bg_file_close(bg_file);
+            return 1;
         }
     }
 
@@ -251,7 +357,102 @@ int bg_mem_addfile(bg_mem_t *bg_mem, char *filename)
 }
 
 
-int bg_mem_addgram(bg_mem_t *bg_mem, unsigned char *buf, int addr, int offs)
+/*
+ * Read a regular file into a new bg_file_t, NULL if it can't be opened or
+ * its size is outside the buffer.
+ */
+bg_file_t *bg_mem_loadfile(bg_mem_t *bg_mem, char *filename)
+{
+    bg_file_t *bg_file;
+    FILE *fp = fopen(filename, "r");
+    if (fp == 0)
+    {
+        fprintf(stderr, "bg_mem_loadfile: failed to open %s (%d %s)\n",
+                                     filename, errno, strerror(errno));
+        return NULL;
+    }
+    bg_file = (bg_file_t *)malloc(sizeof(bg_file_t));
+    if(!bg_file)
+    {
+        fprintf(stderr, "bg_mem_loadfile: malloc failed\n");
+        fclose(fp);
+        return NULL;
+    }
+    DPRINT(("loading file %s ...\n", filename), bg_mem->opt_mask);
+    if(bg_file_init(bg_file,fp, filename, bg_mem->opt_mask) ||
+       (bg_file->size <= 0) || (bg_file->size > bg_mem->buffersize))
+    {
+        fprintf(stderr, "main: Warning! invalid file(%s) size of %d, allowed: %d. Check -b option.\n", 
+            filename,
+            bg_file->size, 
+            bg_mem->buffersize);
+        bg_file_close(bg_file);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+    return bg_file;
+}
+
+//files seen under -r, loaded only once a sampled pair needs them
+int bg_mem_addpath(bg_mem_t *bg_mem, char *filename)
+{
+    if(bg_mem->npath == bg_mem->pathalloc)
+    {
+        int alloc=bg_mem->pathalloc ? bg_mem->pathalloc*2 : 256;
+        char **path=(char **)realloc(bg_mem->path, sizeof(char *)*alloc);
+        if(!path)
+        {
+            fprintf(stderr, "bg_mem_addpath: realloc failed\n");
+            return 1;
+        }
+        bg_mem->path=path;
+        bg_mem->pathalloc=alloc;
+    }
+    bg_mem->path[bg_mem->npath]=strdup(filename);
+    if(!bg_mem->path[bg_mem->npath])
+    {
+        fprintf(stderr, "bg_mem_addpath: strdup failed\n");
+        return 1;
+    }
+    bg_mem->npath++;
+    return 0;
+}
+
+/*
+ * Load the noted files flagged in need[] (all of them if need is NULL) into
+ * the file table, in path order. need[p] becomes the table index of path p,
+ * or -1 if it failed to load.
+ */
+static int bg_mem_loadpaths(bg_mem_t *bg_mem, int *need)
+{
+    int p, n=0;
+    bg_file_t **bg_file;
+
+    for(p=0; p < bg_mem->npath; p++)
+        if(!need || need[p]) n++;
+    bg_file=(bg_file_t **)realloc(bg_mem->bg_file, sizeof(bg_file_t *)*(n ? n : 1));
+    if(!bg_file)
+    {
+        fprintf(stderr, "bg_mem_loadpaths: realloc failed\n");
+        return 1;
+    }
+    bg_mem->bg_file=bg_file;
+    bg_mem->maxfiles=n;
+
+    for(p=0; p < bg_mem->npath; p++)
+    {
+        bg_file_t *f;
+        if(need && !need[p])
+            continue;
+        f=bg_mem_loadfile(bg_mem, bg_mem->path[p]);
+        if(need) need[p]=f ? bg_mem->ind : -1;
+        if(f) bg_mem->bg_file[bg_mem->ind++]=f;
+    }
+    return 0;
+}
+
+int bg_mem_addgram(bg_mem_t *bg_mem, unsigned char *buf, int addr, int offs, int fid1, int fid2)
 {
     int ind=0;
     int hashind=(int)buf[addr];
@@ -276,6 +477,13 @@ int bg_mem_addgram(bg_mem_t *bg_mem, unsigned char *buf, int addr, int offs)
         if((match == offs) && 
            (match == bg_mem->gramdata[hashind][ind].offs))
         {
+            bg_bitmap_add(&bg_mem->gramdata[hashind][ind].files, fid1);
+            bg_bitmap_add(&bg_mem->gramdata[hashind][ind].files, fid2);
+            if(bg_mem->gramdata[hashind][ind].lastpair != bg_mem->pairid)
+            {
+                bg_mem->gramdata[hashind][ind].lastpair=bg_mem->pairid;
+                bg_mem->gramdata[hashind][ind].pairs++;
+            }
             // return on overlapping with existing gram 
             //printf("## %d %d\n", addr, bg_mem->gramdata[hashind][ind].addr);
             //printf("## %d %d\n", addr, bg_mem->gramdata[hashind][ind].addr-bg_mem->gramdata[hashind][ind].offs);
@@ -298,6 +506,211 @@ int bg_mem_addgram(bg_mem_t *bg_mem, unsigned char *buf, int addr, int offs)
     bg_mem->gramdata[hashind][ind].addr=addr;
     bg_mem->gramdata[hashind][ind].offs=offs;
     bg_mem->gramdata[hashind][ind].count++;
+    bg_bitmap_add(&bg_mem->gramdata[hashind][ind].files, fid1);
+    bg_bitmap_add(&bg_mem->gramdata[hashind][ind].files, fid2);
+    bg_mem->gramdata[hashind][ind].lastpair=bg_mem->pairid;
+    bg_mem->gramdata[hashind][ind].pairs=1;
+    return 0;
+}
+
+/*
+ * splitmix64, so a given seed samples the same files/pairs everywhere.
+ */
+unsigned long long bg_rand(bg_mem_t *bg_mem)
+{
+    unsigned long long z=(bg_mem->rng += 0x9E3779B97F4A7C15ULL);
+    z=(z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z=(z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+//uniform in (0,1)
+double bg_rand_double(bg_mem_t *bg_mem)
+{
+    return ((bg_rand(bg_mem) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+//Wilson score interval for a proportion p observed over m trials
+static void bg_wilson(double p, double m, double *lo, double *hi)
+{
+    double z2=BG_SAMPLE_Z*BG_SAMPLE_Z;
+    double den=1.0 + z2/m;
+    double center=(p + z2/(2.0*m))/den;
+    double half=BG_SAMPLE_Z*sqrt(p*(1.0-p)/m + z2/(4.0*m*m))/den;
+    *lo=(center-half < 0.0) ? 0.0 : center-half;
+    *hi=(center+half > 1.0) ? 1.0 : center+half;
+}
+
+//files s holding a gram, given the fraction q of all pairs matching it: q*P = s*(s-1)/2
+static double bg_pairs2support(double q, double pairs)
+{
+    return (1.0 + sqrt(1.0 + 8.0*q*pairs))/2.0;
+}
+
+/*
+ * Files s holding a gram, given 'seen' distinct files out of 'draws' pair
+ * endpoints that matched it: seen = s*(1-(1-1/s)^draws), solved by bisection
+ * in [seen,pop]. Returns -1 when every draw was a new file (no estimate).
+ */
+static double bg_draws2support(double seen, double draws, double pop)
+{
+    double lo=seen, hi=pop;
+    int i;
+
+    if(draws <= seen) return -1.0;
+    if(hi*(1.0-exp(draws*log1p(-1.0/hi))) <= seen) return pop;
+    for(i=0; i < 64; i++)
+    {
+        double mid=(lo+hi)/2.0;
+        if(mid*(1.0-exp(draws*log1p(-1.0/mid))) < seen) lo=mid;
+        else hi=mid;
+    }
+    return (lo+hi)/2.0;
+}
+
+/*
+ * Corpus-wide estimates for a gram seen while sampling. The count is scaled
+ * by the fraction of pairs visited, with a Poisson interval on the observed
+ * count. With sampled pairs, support comes from how often matching pairs
+ * hit files already seen (or, with no repeats, from the fraction of pairs
+ * matching the gram); with sampled files, from the fraction of sampled files
+ * holding it, with a Wilson interval.
+ */
+int bg_mem_estimate(bg_mem_t *bg_mem, gram_t *g, bg_estimate_t *est)
+{
+    double n=bg_mem->ind;
+    double pop=bg_mem->pop;
+    double pop_pairs=pop*(pop-1.0)/2.0;
+    double c=g->count;
+    double sup=bg_bitmap_card(&g->files);
+    double scale, lo, hi;
+
+    if(!bg_mem->pairs_done) return 1;
+    scale=pop_pairs/bg_mem->pairs_done;
+
+    est->count=c*scale;
+    est->count_lo=(c - BG_SAMPLE_Z*sqrt(c))*scale;
+    est->count_hi=(c + BG_SAMPLE_Z*sqrt(c))*scale;
+    if(est->count_lo < c) est->count_lo=c;
+
+    if(bg_mem->sample_pairs)
+    {
+        //recapture of the same files across matching pairs, when there is any
+        double h=g->pairs;
+        est->support=bg_draws2support(sup, 2.0*h, pop);
+        if(est->support >= 0.0)
+        {
+            est->support_lo=bg_draws2support(sup, 2.0*(h + BG_SAMPLE_Z*sqrt(h)), pop);
+            est->support_hi=bg_draws2support(sup, 2.0*(h - BG_SAMPLE_Z*sqrt(h)), pop);
+            if(est->support_hi < 0.0) est->support_hi=pop;
+        }
+        else
+        {
+            double q=h/bg_mem->pairs_done;
+            bg_wilson(q, bg_mem->pairs_done, &lo, &hi);
+            est->support=bg_pairs2support(q, pop_pairs);
+            est->support_lo=bg_pairs2support(lo, pop_pairs);
+            est->support_hi=bg_pairs2support(hi, pop_pairs);
+        }
+    }
+    else
+    {
+        bg_wilson(sup/n, n, &lo, &hi);
+        est->support=sup/n*pop;
+        est->support_lo=lo*pop;
+        est->support_hi=hi*pop;
+    }
+    //the files already seen holding the gram are a hard lower bound
+    if(est->support < sup) est->support=sup;
+    if(est->support_lo < sup) est->support_lo=sup;
+    if(est->support_hi < est->support) est->support_hi=est->support;
+    if(est->support_hi > pop) est->support_hi=pop;
+    return 0;
+}
+
+/*
+ * Drop grams that can no longer reach minsupport. Pairs are visited with an
+ * increasing outer index, so once the first 'done' files have been paired
+ * with everything else they can't add support anymore; the best a gram can
+ * still get is what it has among those files plus every remaining one.
+ * With sampled pairs there is no such bound, the estimate is used instead.
+ */
+int bg_mem_prune(bg_mem_t *bg_mem, int done)
+{
+    int i, j, last, pruned=0;
+    int remaining=bg_mem->ind - done;
+
+    if(!bg_mem->minsupport) return 0;
+
+    for(i=0; i < BG_LIMIT_GRAMDATA; i++)
+    {
+        for(last=0; (last < BG_LIMIT_GRAMDATA_DEPTH) && bg_mem->gramdata[i][last].buf; last++);
+        last--;
+        for(j=0; j <= last; )
+        {
+            gram_t *g=&bg_mem->gramdata[i][j];
+            double bound=remaining;
+            if(bg_mem->sample_pairs)
+            {
+                bg_estimate_t est;
+                bg_mem_estimate(bg_mem, g, &est);
+                bound=est.support;
+            }
+            else if(done > 0) bound+=bg_bitmap_rank(&g->files, done-1);
+            if(bound >= bg_mem->minsupport)
+            {
+                j++;
+                continue;
+            }
+            //keep the chain contiguous, "End of Array" is the first null buf
+            bg_bitmap_free(&g->files);
+            *g=bg_mem->gramdata[i][last];
+            memset(&bg_mem->gramdata[i][last], 0, sizeof(gram_t));
+            last--;
+            pruned++;
+        }
+    }
+    DPRINT(("pruned %d grams below min-support %d (%d/%d files done)\n", pruned, bg_mem->minsupport, done, bg_mem->ind), bg_mem->opt_mask);
+    return pruned;
+}
+
+//the table entry holding exactly these bytes, if any
+static gram_t *bg_mem_findgram(bg_mem_t *bg_mem, unsigned char *buf, int addr, int offs)
+{
+    int ind;
+    int hashind=(int)buf[addr];
+
+    for(ind=0; (ind < BG_LIMIT_GRAMDATA_DEPTH) && bg_mem->gramdata[hashind][ind].buf; ind++)
+    {
+        gram_t *g=&bg_mem->gramdata[hashind][ind];
+        if((g->offs == offs) && !memcmp(g->buf + g->addr, buf + addr, offs))
+            return g;
+    }
+    return NULL;
+}
+
+/*
+ * Once the table has been pruned to minsupport, drop the per-file grams that
+ * no longer have a table entry so the file lists follow the same threshold.
+ */
+int bg_mem_prune_files(bg_mem_t *bg_mem)
+{
+    int i, j, hit;
+
+    if(!bg_mem->minsupport) return 0;
+
+    for(i=0; i < bg_mem->ind; i++)
+    {
+        bg_file_t *bg_file=bg_mem->bg_file[i];
+        for(j=0, hit=0; j < bg_file->hit; j++)
+        {
+            gram_t *g=&bg_file->gram[j];
+            if(bg_mem_findgram(bg_mem, g->buf, g->addr, g->offs))
+                bg_file->gram[hit++]=*g;
+        }
+        memset(&bg_file->gram[hit], 0, sizeof(gram_t)*(bg_file->hit-hit));
+        bg_file->hit=hit;
+    }
     return 0;
 }
 
@@ -312,137 +725,378 @@ int bg_file_addgram(bg_file_t *bg_file, unsigned char *buf, int addr, int offs)
     return 0;
 }
 
-int bg_mem_process(bg_mem_t *bg_mem)
+/*
+ * A run of len matching bytes at f1->buf[a1] and f2->buf[a2], where f1 and
+ * f2 are files i and j of the pair in either order. Runs go straight to the
+ * gram table, or are held until the pair is done when only maximal grams
+ * are wanted.
+ */
+static int bg_mem_addrun(bg_mem_t *bg_mem, bg_file_t *f1, int a1, bg_file_t *f2, int a2, int len, int i, int j)
 {
-    bg_file_t *f1, *f2;
-    int i,j,k,l, flag_inv=0;
-    for(i=0; i<bg_mem->ind; i++)
-        for(j=i+1; j<bg_mem->ind; j++)
+    bg_run_t *run;
+
+    if(!(bg_mem->opt_mask & MODE_MAXIMAL))
     {
-        if( bg_mem->bg_file[i]->size >= bg_mem->bg_file[j]->size )
+        if(!bg_mem_addgram(bg_mem, f2->buf, a2, len, i, j))
         {
-            f1=bg_mem->bg_file[i];
-            f2=bg_mem->bg_file[j];
-            flag_inv=1;
+            bg_file_addgram(f1, f1->buf, a1, len);
+            bg_file_addgram(f2, f2->buf, a2, len);
         }
-        else
+        return 0;
+    }
+
+    if(bg_mem->nrun == bg_mem->runalloc)
+    {
+        int alloc=bg_mem->runalloc ? bg_mem->runalloc*2 : 64;
+        run=(bg_run_t *)realloc(bg_mem->run, sizeof(bg_run_t)*alloc);
+        if(!run)
         {
-            f1=bg_mem->bg_file[j];
-            f2=bg_mem->bg_file[i];
+            fprintf(stderr, "bg_mem_addrun: realloc failed\n");
+            return 1;
         }
+        bg_mem->run=run;
+        bg_mem->runalloc=alloc;
+    }
+    run=&bg_mem->run[bg_mem->nrun++];
+    //f1/f2 swap between passes, keep runs in (file i, file j) order
+    if(f1 == bg_mem->bg_file[i])
+    {
+        run->ai=a1;
+        run->aj=a2;
+    }
+    else
+    {
+        run->ai=a2;
+        run->aj=a1;
+    }
+    run->len=len;
+    run->drop=0;
+    return 0;
+}
 
-        int sequence=0;
-        for(k=0; k < f1->size; k++)
+//(ai, -len, aj): a full order, so which copy survives doesn't depend on qsort
+static int bg_run_cmp_i(const void *a, const void *b)
+{
+    const bg_run_t *x=(const bg_run_t *)a, *y=(const bg_run_t *)b;
+    if(x->ai != y->ai) return (x->ai > y->ai) - (x->ai < y->ai);
+    if(x->len != y->len) return (x->len < y->len) - (x->len > y->len);
+    return (x->aj > y->aj) - (x->aj < y->aj);
+}
+
+//(aj, -len, ai)
+static int bg_run_cmp_j(const void *a, const void *b)
+{
+    const bg_run_t *x=(const bg_run_t *)a, *y=(const bg_run_t *)b;
+    if(x->aj != y->aj) return (x->aj > y->aj) - (x->aj < y->aj);
+    if(x->len != y->len) return (x->len < y->len) - (x->len > y->len);
+    return (x->ai > y->ai) - (x->ai < y->ai);
+}
+
+//(-len, ai, aj)
+static int bg_run_cmp_len(const void *a, const void *b)
+{
+    const bg_run_t *x=(const bg_run_t *)a, *y=(const bg_run_t *)b;
+    if(x->len != y->len) return (x->len < y->len) - (x->len > y->len);
+    if(x->ai != y->ai) return (x->ai > y->ai) - (x->ai < y->ai);
+    return (x->aj > y->aj) - (x->aj < y->aj);
+}
+
+//buf[0..len) holds sub[0..sublen) somewhere
+static int bg_buf_contains(unsigned char *buf, int len, unsigned char *sub, int sublen)
+{
+    int k;
+    for(k=0; k + sublen <= len; k++)
+        if(buf[k] == sub[0] && !memcmp(buf + k, sub, sublen))
+            return 1;
+    return 0;
+}
+
+/*
+ * Keep only maximal runs of a pair. Runs on a diagonal already can't be
+ * extended, but the same region shows up again shifted or truncated on
+ * other diagonals. Sorting by start (longest first) and sweeping the
+ * furthest end seen drops every run whose interval lies inside another
+ * one, in file i and then in file j. What is left is checked by content,
+ * longest first, so a run whose bytes repeat inside a longer kept run
+ * elsewhere is dropped too, all before the gram table is touched.
+ */
+static int bg_mem_flushruns(bg_mem_t *bg_mem, int i, int j)
+{
+    bg_file_t *fi=bg_mem->bg_file[i];
+    bg_file_t *fj=bg_mem->bg_file[j];
+    int n, m, end, kept=0;
+
+    if(!bg_mem->nrun) return 0;
+    qsort(bg_mem->run, bg_mem->nrun, sizeof(bg_run_t), bg_run_cmp_i);
+    for(n=0, end=0; n < bg_mem->nrun; n++)
+    {
+        bg_run_t *r=&bg_mem->run[n];
+        if(r->ai + r->len <= end) r->drop=1;
+        else end=r->ai + r->len;
+    }
+
+    qsort(bg_mem->run, bg_mem->nrun, sizeof(bg_run_t), bg_run_cmp_j);
+    for(n=0, end=0; n < bg_mem->nrun; n++)
+    {
+        bg_run_t *r=&bg_mem->run[n];
+        if(r->aj + r->len <= end) r->drop=1;
+        else end=r->aj + r->len;
+    }
+
+    for(n=0, m=0; n < bg_mem->nrun; n++)
+        if(!bg_mem->run[n].drop)
+            bg_mem->run[m++]=bg_mem->run[n];
+    qsort(bg_mem->run, m, sizeof(bg_run_t), bg_run_cmp_len);
+    for(n=0; n < m; n++)
+    {
+        bg_run_t *r=&bg_mem->run[n];
+        int l;
+        for(l=0; (l < kept) && (bg_mem->run[l].len > r->len); l++)
+            if(bg_buf_contains(fj->buf + bg_mem->run[l].aj, bg_mem->run[l].len, fj->buf + r->aj, r->len))
+                break;
+        if((l < kept) && (bg_mem->run[l].len > r->len))
+            continue;
+        bg_mem->run[kept++]=*r;
+        if(!bg_mem_addgram(bg_mem, fj->buf, r->aj, r->len, i, j))
         {
-            for (l=0; (l < f2->size) && ((k+l) < f1->size); l++)
+            bg_file_addgram(fi, fi->buf, r->ai, r->len);
+            bg_file_addgram(fj, fj->buf, r->aj, r->len);
+        }
+    }
+    DPRINT(("pair (%d,%d): %d maximal grams out of %d runs\n", i, j, kept, bg_mem->nrun), bg_mem->opt_mask);
+    bg_mem->nrun=0;
+    return kept;
+}
+
+/*
+ * Match one pair of loaded files on every diagonal, both ways around.
+ */
+static int bg_mem_process_pair(bg_mem_t *bg_mem, int i, int j)
+{
+    bg_file_t *f1, *f2;
+    int k,l, flag_inv=0;
+    int sequence=0;
+
+    bg_mem->pairid++;
+
+    if( bg_mem->bg_file[i]->size >= bg_mem->bg_file[j]->size )
+    {
+        f1=bg_mem->bg_file[i];
+        f2=bg_mem->bg_file[j];
+        flag_inv=1;
+    }
+    else
+    {
+        f1=bg_mem->bg_file[j];
+        f2=bg_mem->bg_file[i];
+    }
+
+    for(k=0; k < f1->size; k++)
+    {
+        for (l=0; (l < f2->size) && ((k+l) < f1->size); l++)
+        {
+            if(f1->buf[k+l] == f2->buf[l])
             {
-                if(f1->buf[k+l] == f2->buf[l])
-                {
-                    DPRINT(("f1[%d]=%02X == %02X=f2[%d] \n", k+l, f1->buf[k+l], f2->buf[l], l), bg_mem->opt_mask);
-                    sequence++;
-                }
-                else if(sequence > 0)
-                {
-                    if(sequence >= bg_mem->gramsize)
-                    {
-                        int ret;
-                        //ret=bg_mem_addgram(bg_mem, f1->buf, k+l-sequence, sequence);
-                        ret=bg_mem_addgram(bg_mem, f2->buf, l-sequence, sequence);
-                        if(!ret)
-                        {
-                            bg_file_addgram(f1, f1->buf, k+l-sequence, sequence);
-                            bg_file_addgram(f2, f2->buf, l-sequence, sequence);
-                        }
-                        sequence=0;
-                    }
-                    
-                }
-                
-            } //for l
-            if(sequence > 0)
+                DPRINT(("f1[%d]=%02X == %02X=f2[%d] \n", k+l, f1->buf[k+l], f2->buf[l], l), bg_mem->opt_mask);
+                sequence++;
+            }
+            else if(sequence > 0)
             {
-                    if(sequence >= bg_mem->gramsize)
-                    {
-                        int ret;
-                        ret=bg_mem_addgram(bg_mem, f1->buf, k+l-sequence, sequence);
-                        if(!ret)
-                        {
-                            bg_file_addgram(f1, f1->buf, k+l-sequence, sequence);
-                            bg_file_addgram(f2, f2->buf, l-sequence, sequence);
-                        }
-                        
-                    }       
+                if(sequence >= bg_mem->gramsize)
+                    bg_mem_addrun(bg_mem, f1, k+l-sequence, f2, l-sequence, sequence, i, j);
+                sequence=0;
             }
-            sequence=0;
-        }//for k
+        } //for l
+        if(sequence >= bg_mem->gramsize)
+            bg_mem_addrun(bg_mem, f1, k+l-sequence, f2, l-sequence, sequence, i, j);
+        sequence=0;
+    }//for k
 
-        if(flag_inv)
-        {
-            f1=bg_mem->bg_file[j];
-            f2=bg_mem->bg_file[i];
-        }
-        else
-        {
-            f1=bg_mem->bg_file[i];
-            f2=bg_mem->bg_file[j];
-        }
-        for(k=1; k < f1->size; k++)
+    if(flag_inv)
+    {
+        f1=bg_mem->bg_file[j];
+        f2=bg_mem->bg_file[i];
+    }
+    else
+    {
+        f1=bg_mem->bg_file[i];
+        f2=bg_mem->bg_file[j];
+    }
+    for(k=1; k < f1->size; k++)
+    {
+        for (l=0; (l < f2->size) && ((k+l) < f1->size); l++)
         {
-            for (l=0; (l < f2->size) && ((k+l) < f1->size); l++)
+            if(f1->buf[k+l] == f2->buf[l])
             {
-                if(f1->buf[k+l] == f2->buf[l])
-                {
-                    DPRINT(("f1[%d]=%02X == %02X=f2[%d] \n", k+l, f1->buf[k+l], f2->buf[l], l), bg_mem->opt_mask);
-                    sequence++;
-                }
-                else if(sequence > 0)
-                {
-                    if(sequence >= bg_mem->gramsize)
-                    {
-                        int ret;
-                        ret=bg_mem_addgram(bg_mem, f2->buf, l-sequence, sequence);
-                        if(!ret)
-                        {
-                            bg_file_addgram(f1, f1->buf, k+l-sequence, sequence);
-                            bg_file_addgram(f2, f2->buf, l-sequence, sequence);
-                        }
-                        sequence=0;
-                    }
-                    
-                }
-                
-            } //for l
-            if(sequence > 0)
+                DPRINT(("f1[%d]=%02X == %02X=f2[%d] \n", k+l, f1->buf[k+l], f2->buf[l], l), bg_mem->opt_mask);
+                sequence++;
+            }
+            else if(sequence > 0)
             {
-                    if(sequence >= bg_mem->gramsize)
-                    {
-                        int ret;
-                        ret=bg_mem_addgram(bg_mem, f1->buf, k+l-sequence, sequence);
-                        if(!ret)
-                        {
-                            bg_file_addgram(f1, f1->buf, k+l-sequence, sequence);
-                            bg_file_addgram(f2, f2->buf, l-sequence, sequence);
-                        }
-                        
-                    }       
+                if(sequence >= bg_mem->gramsize)
+                    bg_mem_addrun(bg_mem, f1, k+l-sequence, f2, l-sequence, sequence, i, j);
+                sequence=0;
             }
-            sequence=0;
-        }//for k
+        } //for l
+        if(sequence >= bg_mem->gramsize)
+            bg_mem_addrun(bg_mem, f1, k+l-sequence, f2, l-sequence, sequence, i, j);
+        sequence=0;
+    }//for k
+
+    if(bg_mem->opt_mask & MODE_MAXIMAL)
+        bg_mem_flushruns(bg_mem, i, j);
 
-    } //for i+j
-        
     return 0;
 }
 
-int bg_mem_close(bg_mem_t *bg_mem)
+static int bg_pair_cmp(const void *a, const void *b)
 {
-    int i;
+    long long x=*(const long long *)a, y=*(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Reservoir sample of sample_pairs pair indexes out of npath*(npath-1)/2,
+ * using skips (Li's algorithm L) so the cost follows the sample size and
+ * not the number of pairs. Only the files used by sampled pairs are read,
+ * then the pairs are visited in index order.
+ */
+static int bg_mem_process_sample(bg_mem_t *bg_mem, long long total)
+{
+    long long *sample, next;
+    int r=bg_mem->sample_pairs;
+    int npath=bg_mem->npath;
+    int i, j, n, *need;
+    double w;
+
+    sample=(long long *)malloc(sizeof(long long)*r);
+    need=(int *)calloc(npath, sizeof(int));
+    if(!sample || !need)
+    {
+        fprintf(stderr, "bg_mem_process_sample: malloc failed\n");
+        free(sample);
+        free(need);
+        return 1;
+    }
+    for(n=0; n < r; n++)
+        sample[n]=n;
+
+    w=exp(log(bg_rand_double(bg_mem))/r);
+    next=r-1;
+    for(;;)
+    {
+        next+=(long long)floor(log(bg_rand_double(bg_mem))/log(1.0-w)) + 1;
+        if(next >= total) break;
+        sample[bg_rand(bg_mem) % r]=next;
+        w*=exp(log(bg_rand_double(bg_mem))/r);
+    }
+    qsort(sample, r, sizeof(long long), bg_pair_cmp);
+
+    //pair index p maps to row i, which holds pairs (i,i+1)..(i,npath-1)
+    i=0;
+    next=0; //index of pair (i,i+1)
+    for(n=0; n < r; n++)
+    {
+        while(sample[n] >= next + (npath - 1 - i))
+        {
+            next+=npath - 1 - i;
+            i++;
+        }
+        j=i + 1 + (int)(sample[n] - next);
+        DPRINT(("sampled pair %lld (%s,%s)\n", sample[n], bg_mem->path[i], bg_mem->path[j]), bg_mem->opt_mask);
+        need[i]=need[j]=1;
+        sample[n]=(long long)i*npath + j;
+    }
+
+    bg_mem_loadpaths(bg_mem, need);
+    for(n=0; n < r; n++)
+    {
+        i=need[sample[n] / npath];
+        j=need[sample[n] % npath];
+        if(i < 0 || j < 0) continue;
+        bg_mem_process_pair(bg_mem, i, j);
+        bg_mem->pairs_done++;
+    }
+
+    free(need);
+    free(sample);
+    return 0;
+}
+
+int bg_mem_process(bg_mem_t *bg_mem)
+{
+    int i,j;
+    long long total;
+
+    if(bg_mem->sample_pairs)
+    {
+        total=(long long)bg_mem->npath*(bg_mem->npath-1)/2;
+        if(bg_mem->sample_pairs < total)
+        {
+            bg_mem->pop=bg_mem->npath;
+            if(bg_mem->minsupport_pct)
+                bg_mem->minsupport=(bg_mem->minsupport_pct*bg_mem->pop + 99)/100;
+            bg_mem_process_sample(bg_mem, total);
+            //support can't be bounded from a sample, filter on the estimates
+            bg_mem_prune(bg_mem, bg_mem->ind);
+            bg_mem_prune_files(bg_mem);
+            return 0;
+        }
+        //the sample covers every pair, match them all
+        bg_mem_loadpaths(bg_mem, NULL);
+        bg_mem->sample_pairs=0;
+    }
+
+    //every file fit in the reservoir, nothing to estimate
+    if(bg_mem->sample_files && bg_mem->seen <= bg_mem->sample_files)
+        bg_mem->sample_files=0;
+
+    total=(long long)bg_mem->ind*(bg_mem->ind-1)/2;
+    bg_mem->pop=bg_mem->sample_files ? bg_mem->seen : bg_mem->ind;
+
+    if(bg_mem->minsupport_pct)
+        bg_mem->minsupport=(bg_mem->minsupport_pct*bg_mem->ind + 99)/100;
+    else if(bg_mem->sample_files && bg_mem->minsupport)
+    {
+        //absolute threshold is on the whole corpus, scale it to the sample
+        long long seen=bg_mem->seen;
+        bg_mem->minsupport=(unsigned int)(((long long)bg_mem->minsupport*bg_mem->ind + seen-1)/seen);
+        if(!bg_mem->minsupport) bg_mem->minsupport=1;
+    }
+
     for(i=0; i<bg_mem->ind; i++)
     {
-        free(bg_mem->bg_file[i]->filename);
-        free(bg_mem->bg_file[i]->buf);
-        free(bg_mem->bg_file[i]);
+        for(j=i+1; j<bg_mem->ind; j++)
+            bg_mem_process_pair(bg_mem, i, j);
+        bg_mem_prune(bg_mem, i+1);
     }
+    bg_mem_prune_files(bg_mem);
+    bg_mem->pairs_done=total;
+
+    return 0;
+}
+
+int bg_mem_close(bg_mem_t *bg_mem)
+{
+    int i,j;
+    for(i=0; i < BG_LIMIT_GRAMDATA; i++)
+        for(j=0; j < BG_LIMIT_GRAMDATA_DEPTH; j++)
+            bg_bitmap_free(&bg_mem->gramdata[i][j].files);
+    free(bg_mem->run);
+    for(i=0; i<bg_mem->npath; i++)
+        free(bg_mem->path[i]);
+    free(bg_mem->path);
+    for(i=0; i<bg_mem->ind; i++)
+        bg_file_close(bg_mem->bg_file[i]);
+    free(bg_mem->bg_file);
+    return 0;
+}
+
+int bg_file_close(bg_file_t *bg_file)
+{
+    free(bg_file->filename);
+    free(bg_file->buf);
+    free(bg_file);
     return 0;
 }
 
@@ -450,6 +1104,7 @@ int bg_file_init(bg_file_t *bg_file, FILE *f, char *filename, opt_mask_t opt_mas
 {
     struct stat st;
     stat(filename, &st);
+    memset(bg_file, 0, sizeof(bg_file_t));
 
     /*if (opt_mask & MODE_STRINGS)
     {
@@ -487,6 +1142,167 @@ int bg_file_init(bg_file_t *bg_file, FILE *f, char *filename, opt_mask_t opt_mas
     return 0;
 }
 
+/*
+ * File-occurrence bitmaps, roaring style: file indexes are split by their
+ * high 16 bits into containers, each one either a sorted array of the low
+ * 16 bits (sparse) or a 65536 bit set (dense).
+ */
+static bg_container_t *bg_bitmap_container(bg_bitmap_t *bm, unsigned short key, int create)
+{
+    int lo=0, hi=bm->n;
+    bg_container_t *c;
+
+    while(lo < hi)
+    {
+        int mid=(lo+hi)/2;
+        if(bm->c[mid].key < key) lo=mid+1;
+        else hi=mid;
+    }
+    if(lo < bm->n && bm->c[lo].key == key) return &bm->c[lo];
+    if(!create) return NULL;
+
+    c=(bg_container_t *)realloc(bm->c, sizeof(bg_container_t)*(bm->n+1));
+    if(!c)
+    {
+        fprintf(stderr, "bg_bitmap_container: realloc failed\n");
+        return NULL;
+    }
+    bm->c=c;
+    memmove(&bm->c[lo+1], &bm->c[lo], sizeof(bg_container_t)*(bm->n-lo));
+    memset(&bm->c[lo], 0, sizeof(bg_container_t));
+    bm->c[lo].key=key;
+    bm->c[lo].type=BG_CONTAINER_ARRAY;
+    bm->n++;
+    return &bm->c[lo];
+}
+
+static int bg_container_tobitset(bg_container_t *c)
+{
+    int i;
+    unsigned short *arr=(unsigned short *)c->data;
+    unsigned long long *bits=(unsigned long long *)calloc(BG_BITMAP_BITSETWORDS, sizeof(unsigned long long));
+    if(!bits)
+    {
+        fprintf(stderr, "bg_container_tobitset: calloc failed\n");
+        return 1;
+    }
+    for(i=0; i < c->card; i++)
+        bits[arr[i] >> 6] |= 1ULL << (arr[i] & 63);
+    free(c->data);
+    c->data=bits;
+    c->type=BG_CONTAINER_BITSET;
+    c->alloc=0;
+    return 0;
+}
+
+//returns 1 if x was not in the bitmap yet
+int bg_bitmap_add(bg_bitmap_t *bm, unsigned int x)
+{
+    unsigned short low=(unsigned short)(x & 0xFFFF);
+    bg_container_t *c=bg_bitmap_container(bm, (unsigned short)(x >> 16), 1);
+    unsigned short *arr;
+    int lo, hi;
+
+    if(!c) return 0;
+    if(c->type == BG_CONTAINER_BITSET)
+    {
+        unsigned long long *bits=(unsigned long long *)c->data;
+        unsigned long long mask=1ULL << (low & 63);
+        if(bits[low >> 6] & mask) return 0;
+        bits[low >> 6] |= mask;
+        c->card++;
+        return 1;
+    }
+
+    arr=(unsigned short *)c->data;
+    lo=0; hi=c->card;
+    while(lo < hi)
+    {
+        int mid=(lo+hi)/2;
+        if(arr[mid] < low) lo=mid+1;
+        else hi=mid;
+    }
+    if(lo < c->card && arr[lo] == low) return 0;
+
+    if(c->card == BG_BITMAP_ARRAYMAX)
+    {
+        if(bg_container_tobitset(c)) return 0;
+        return bg_bitmap_add(bm, x);
+    }
+    if(c->card == c->alloc)
+    {
+        int alloc=c->alloc ? c->alloc*2 : 4;
+        if(alloc > BG_BITMAP_ARRAYMAX) alloc=BG_BITMAP_ARRAYMAX;
+        arr=(unsigned short *)realloc(c->data, sizeof(unsigned short)*alloc);
+        if(!arr)
+        {
+            fprintf(stderr, "bg_bitmap_add: realloc failed\n");
+            return 0;
+        }
+        c->data=arr;
+        c->alloc=alloc;
+    }
+    memmove(&arr[lo+1], &arr[lo], sizeof(unsigned short)*(c->card-lo));
+    arr[lo]=low;
+    c->card++;
+    return 1;
+}
+
+int bg_bitmap_card(bg_bitmap_t *bm)
+{
+    int i, card=0;
+    for(i=0; i < bm->n; i++)
+        card+=bm->c[i].card;
+    return card;
+}
+
+//number of set indexes less than or equal to x
+int bg_bitmap_rank(bg_bitmap_t *bm, unsigned int x)
+{
+    unsigned short key=(unsigned short)(x >> 16);
+    unsigned short low=(unsigned short)(x & 0xFFFF);
+    int i, rank=0;
+
+    for(i=0; (i < bm->n) && (bm->c[i].key < key); i++)
+        rank+=bm->c[i].card;
+    if(i == bm->n || bm->c[i].key != key) return rank;
+
+    if(bm->c[i].type == BG_CONTAINER_BITSET)
+    {
+        unsigned long long *bits=(unsigned long long *)bm->c[i].data;
+        int w;
+        for(w=0; w < (low >> 6); w++)
+            rank+=__builtin_popcountll(bits[w]);
+        if((low & 63) == 63)
+            rank+=__builtin_popcountll(bits[w]);
+        else
+            rank+=__builtin_popcountll(bits[w] & ((1ULL << ((low & 63) + 1)) - 1));
+    }
+    else
+    {
+        unsigned short *arr=(unsigned short *)bm->c[i].data;
+        int lo=0, hi=bm->c[i].card;
+        while(lo < hi)
+        {
+            int mid=(lo+hi)/2;
+            if(arr[mid] <= low) lo=mid+1;
+            else hi=mid;
+        }
+        rank+=lo;
+    }
+    return rank;
+}
+
+void bg_bitmap_free(bg_bitmap_t *bm)
+{
+    int i;
+    for(i=0; i < bm->n; i++)
+        free(bm->c[i].data);
+    free(bm->c);
+    bm->c=NULL;
+    bm->n=0;
+}
+
 json_object *json_get_key_val(char *key, int val)
 {
     json_object *jobj=json_object_new_object();
@@ -495,6 +1311,25 @@ json_object *json_get_key_val(char *key, int val)
     return jobj;
 }
 
+//"est" object of a table gram, NULL unless sampling
+json_object *json_get_estimate(bg_mem_t *bg_mem, gram_t *g)
+{
+    bg_estimate_t est;
+    json_object *jobj;
+
+    if(!g->files.n || !BG_MEM_SAMPLING(bg_mem)) return NULL;
+    if(bg_mem_estimate(bg_mem, g, &est)) return NULL;
+
+    jobj=json_object_new_object();
+    json_object_object_add(jobj, "cnt", json_object_new_double(est.count));
+    json_object_object_add(jobj, "cnt_lo", json_object_new_double(est.count_lo));
+    json_object_object_add(jobj, "cnt_hi", json_object_new_double(est.count_hi));
+    json_object_object_add(jobj, "sup", json_object_new_double(est.support));
+    json_object_object_add(jobj, "sup_lo", json_object_new_double(est.support_lo));
+    json_object_object_add(jobj, "sup_hi", json_object_new_double(est.support_hi));
+    return jobj;
+}
+
 int bg_mem_show(bg_mem_t *bg_mem)
 {
     int i,j,k;
@@ -534,7 +1369,7 @@ int bg_mem_show(bg_mem_t *bg_mem)
         for(j=0; j < BG_LIMIT_GRAMDATA_DEPTH; j++)
     {
         gram_t *g=&bg_mem->gramdata[i][j];
-        GRAM2JSON(g);
+        GRAM2JSON(g, json_get_estimate(bg_mem, g));
     }
     
     for(i=0; (i < bg_mem->ind); i++)
@@ -587,7 +1422,7 @@ int bg_mem_show(bg_mem_t *bg_mem)
         for(j=0; j< bg_file->hit; j++)
         {
             gram_t *g=&bg_file->gram[j];
-            GRAM2JSON(g);
+            GRAM2JSON(g, NULL);
         }
 
         json_object_object_add(jobj_file, bg_file->filename, jobj_params);
@@ -600,6 +1435,19 @@ int bg_mem_show(bg_mem_t *bg_mem)
     json_object_object_add(jobj_bingram,"file", jarr_file);
     json_object_object_add(jobj_bingram,"gram", jarr_gram);
 
+    if(BG_MEM_SAMPLING(bg_mem))
+    {
+        json_object *jobj_sample = json_object_new_object();
+        int pop=bg_mem->pop;
+        json_object_object_add(jobj_sample, "mode", json_object_new_string(bg_mem->sample_files ? "files" : "pairs"));
+        json_object_object_add(jobj_sample, "seed", json_object_new_int64(bg_mem->seed));
+        json_object_object_add(jobj_sample, "files", json_object_new_int(bg_mem->ind));
+        json_object_object_add(jobj_sample, "files_total", json_object_new_int(pop));
+        json_object_object_add(jobj_sample, "pairs", json_object_new_int64(bg_mem->pairs_done));
+        json_object_object_add(jobj_sample, "pairs_total", json_object_new_int64((long long)pop*(pop-1)/2));
+        json_object_object_add(jobj_bingram,"sample", jobj_sample);
+    }
+
     if(bg_mem->opt_mask & MODE_JSONPTY)
         printf ("%s\n",json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PRETTY));
     else
@@ -27,16 +27,23 @@
 #define BG_DEFAULT_MAXFILES     200
 #define BG_DEFAULT_BUFFERSIZE   1500
 #define BG_DEFAULT_EDITDIST     0
+#define BG_DEFAULT_SEED         1
 #define BG_LIMIT_BUFFERSIZE     8000
 #define BG_LIMIT_MAXFILES       18000
 #define BG_LIMIT_GRAMDATA       (sizeof(unsigned char) << CHAR_BIT)
 #define BG_LIMIT_GRAMDATA_DEPTH 500
 #define BG_LIMIT_EDITDIST       5
+#define BG_LIMIT_SAMPLEPAIRS    100000000
 #define BG_LIMIT_FULLPATH       200
 #define BG_LIMIT_FILEHIT        200
 #define BG_LIMIT_HISTOGRAM      256
 #define BG_LIMIT_OUTBUF         2400
 #define BG_LIMIT_HISTBUF        256*4+2
+#define BG_BITMAP_ARRAYMAX      4096  //array container converts to bitset above this
+#define BG_BITMAP_BITSETWORDS   (65536/64)
+#define BG_SAMPLE_Z             1.96  //95% confidence intervals
+
+#define BG_MEM_SAMPLING(m)      ((m)->sample_pairs || (m)->sample_files)
 
 typedef enum { 
   MODE_DEFAULT = 0,
@@ -44,15 +51,43 @@ typedef enum {
   MODE_BYTECNT = 0x02,
   MODE_STRINGS = 0x04,
   MODE_JSONPTY = 0x08,
+  MODE_MAXIMAL = 0x10,
 } opt_mask_t;
 
+typedef enum {
+  BG_CONTAINER_ARRAY  = 0, //sorted unsigned short, up to BG_BITMAP_ARRAYMAX
+  BG_CONTAINER_BITSET = 1, //65536 bits
+} bg_container_type_t;
+
+typedef struct {
+  unsigned short key;  //high 16 bits of file index
+  unsigned short type; //bg_container_type_t
+  int card;            //number of files set in this container
+  int alloc;           //allocated entries (array containers only)
+  void *data;
+} bg_container_t;
+
+typedef struct {
+  int n;               //number of containers, sorted by key
+  bg_container_t *c;
+} bg_bitmap_t;
+
 typedef struct {
   unsigned char *buf; //null indicates "End of Array"
   int addr,offs; //start address/index,
   int count;     //number of occurances,
+  bg_bitmap_t files; //files holding this gram (support)
+  int pairs;     //number of file pairs matching this gram,
+  int lastpair;  //last pair that matched, see bg_mem_t.pairid
   //char *out_json;
 } gram_t;
 
+typedef struct {
+  int ai, aj;    //start address in file i and file j of the pair,
+  int len;
+  int drop;      //contained in a longer run of the same pair
+} bg_run_t;
+
 typedef struct {
   int size;
   int hit;
@@ -68,6 +103,20 @@ typedef struct {
   unsigned int buffersize;
   unsigned int gramsize;
   unsigned int editdist;
+  unsigned int minsupport;     //files, resolved from minsupport_pct if set
+  unsigned int minsupport_pct; //percentage of loaded files, 0 if unused
+  unsigned int sample_pairs;   //pairs to sample, 0 to match all pairs
+  unsigned int sample_files;   //files to sample, 0 to load all files
+  unsigned int seed;
+  unsigned long long rng;      //sampling state, see bg_rand
+  int seen;                    //files offered to the file reservoir
+  int pop;                     //files in the corpus the estimates refer to
+  char **path;                 //files noted for pair sampling
+  int npath, pathalloc;
+  int pairid;                  //pair being matched, starts at 1
+  long long pairs_done;        //pairs matched
+  bg_run_t *run;               //runs of the current pair (MODE_MAXIMAL)
+  int nrun, runalloc;
   opt_mask_t opt_mask;
   int ind; //for file
   bg_file_t **bg_file;
@@ -75,15 +124,32 @@ typedef struct {
   //char *out_json;
 } bg_mem_t;
 
+typedef struct {
+  double count, count_lo, count_hi;
+  double support, support_lo, support_hi;
+} bg_estimate_t;
+
 
 int bg_mem_init(bg_mem_t *bg_mem, opt_mask_t opt_mask, int maxfiles, int buffersize, int gramsize);
 int bg_mem_show(bg_mem_t *bg_mem);
-int bg_mem_addgram(bg_mem_t *bg_mem, unsigned char *buf, int addr, int offs);
+int bg_mem_addgram(bg_mem_t *bg_mem, unsigned char *buf, int addr, int offs, int fid1, int fid2);
+int bg_mem_prune(bg_mem_t *bg_mem, int done);
+int bg_mem_prune_files(bg_mem_t *bg_mem);
+int bg_mem_estimate(bg_mem_t *bg_mem, gram_t *g, bg_estimate_t *est);
+unsigned long long bg_rand(bg_mem_t *bg_mem);
+double bg_rand_double(bg_mem_t *bg_mem);
 int bg_mem_addfile(bg_mem_t *bg_mem, char *filename);
+int bg_mem_addpath(bg_mem_t *bg_mem, char *filename);
+bg_file_t *bg_mem_loadfile(bg_mem_t *bg_mem, char *filename);
 int bg_mem_process(bg_mem_t *bg_mem);
 int bg_mem_close(bg_mem_t *bg_mem);
 int bg_file_init(bg_file_t *bg_file, FILE *f, char *filename, opt_mask_t opt_mask);
+int bg_file_close(bg_file_t *bg_file);
 int bg_file_addgram(bg_file_t *bg_file, unsigned char *buf, int addr, int offs);
+int bg_bitmap_add(bg_bitmap_t *bm, unsigned int x);
+int bg_bitmap_card(bg_bitmap_t *bm);
+int bg_bitmap_rank(bg_bitmap_t *bm, unsigned int x);
+void bg_bitmap_free(bg_bitmap_t *bm);
 
 
 #endif
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+#
+#  check_json.py - assertions on bingram json output, used by run_test.sh
+#
+#  usage: check_json.py <output.json> <check> [args ...]
+#
+#    table-has <gram> [key=val ...]  gram is in the table (with those params)
+#    table-lacks <gram>              gram is not in the table
+#    occur <dir>                     every per-file gram is found in its file at
+#                                    addr, every table gram in at least sup files
+#    minsup <n>                      table grams have sup >= n, per-file grams
+#                                    all have a table entry
+#    maximal                         no table gram is inside another one
+#    covers <full.json>              every table gram of full.json is inside
+#                                    some table gram here
+#    sample <mode> <files_total>     sampling summary and estimate intervals
+#
+import json
+import os
+import sys
+
+
+def fail(msg):
+    sys.stderr.write("check_json: %s: %s\n" % (sys.argv[1], msg))
+    sys.exit(1)
+
+
+def load(path):
+    text = open(path).read()
+    if '{' not in text:
+        fail("no json output")
+    return json.loads(text[text.index('{'):])['bingram']
+
+
+def grams(arr):
+    return [(k, v) for g in arr for k, v in g.items()]
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.stderr.write("usage: %s <output.json> <check> [args ...]\n" % sys.argv[0])
+        sys.exit(2)
+
+    out = load(sys.argv[1])
+    check, args = sys.argv[2], sys.argv[3:]
+    table = dict(grams(out['gram']))
+
+    if check == 'table-has':
+        if args[0] not in table:
+            fail("gram %s missing from table" % args[0])
+        for kv in args[1:]:
+            k, v = kv.split('=')
+            if str(table[args[0]].get(k)) != v:
+                fail("gram %s has %s=%s, expected %s" % (args[0], k, table[args[0]].get(k), v))
+
+    elif check == 'table-lacks':
+        if args[0] in table:
+            fail("gram %s should not be in table" % args[0])
+
+    elif check == 'occur':
+        data = [open(os.path.join(args[0], f), 'rb').read() for f in os.listdir(args[0])
+                if not f.startswith('.')]
+        for f in out['file']:
+            for name, params in f.items():
+                buf = open(name, 'rb').read()
+                for gram, g in grams(params['gram']):
+                    if buf[g['addr']:g['addr'] + g['offs']] != bytes.fromhex(gram):
+                        fail("gram %s not in %s at %d" % (gram, name, g['addr']))
+        for gram, g in table.items():
+            found = sum(1 for d in data if bytes.fromhex(gram) in d)
+            if found < max(2, g.get('sup', 2)):
+                fail("gram %s found in %d files, reported sup %s" % (gram, found, g.get('sup')))
+
+    elif check == 'minsup':
+        for gram, g in table.items():
+            if g['sup'] < int(args[0]):
+                fail("gram %s has sup %d below %s" % (gram, g['sup'], args[0]))
+        for f in out['file']:
+            for name, params in f.items():
+                for gram, g in grams(params['gram']):
+                    if gram not in table:
+                        fail("gram %s listed for %s but pruned from table" % (gram, name))
+
+    elif check == 'maximal':
+        for a in table:
+            for b in table:
+                if a != b and len(a) < len(b) and bytes.fromhex(a) in bytes.fromhex(b):
+                    fail("gram %s is inside gram %s" % (a, b))
+
+    elif check == 'covers':
+        for a in dict(grams(load(args[0])['gram'])):
+            if not any(bytes.fromhex(a) in bytes.fromhex(b) for b in table):
+                fail("gram %s of %s is not inside any gram" % (a, args[0]))
+
+    elif check == 'sample':
+        s = out.get('sample')
+        if not s:
+            fail("no sample summary")
+        if s['mode'] != args[0] or s['files_total'] != int(args[1]):
+            fail("sample is %s over %s files" % (s['mode'], s['files_total']))
+        for k in ('seed', 'files', 'files_total', 'pairs', 'pairs_total'):
+            if not isinstance(s[k], int):
+                fail("sample %s is not an integer" % k)
+        for gram, g in table.items():
+            e = g.get('est')
+            if not e:
+                fail("gram %s has no estimate" % gram)
+            if not (e['cnt_lo'] <= e['cnt'] <= e['cnt_hi']) or not (e['sup_lo'] <= e['sup'] <= e['sup_hi']):
+                fail("gram %s estimate outside its interval" % gram)
+            if e['sup_hi'] > s['files_total']:
+                fail("gram %s support above files_total" % gram)
+
+    else:
+        fail("unknown check %s" % check)
+
+
+if __name__ == '__main__':
+    main()
@@ -1,5 +1,7 @@
 #!/bin/sh
 
+check_json="python3 ../test/check_json.py"
+
 echo "Running test1.."
 ./bingram ../test/t1 > ../test/t1.out.1.json
 jsonlint -v ../test/t1.out.1.json
@@ -25,6 +27,7 @@ jsonlint -v ../test/t2.out.3.json
 echo "Running test3.."
 ./bingram ../test/t3 > ../test/t3.out.1.json
 jsonlint -v ../test/t3.out.1.json
+$check_json ../test/t3.out.1.json table-has 5878 sup=3 || exit 1
 
 ./bingram -v ../test/t3 | grep -v "bg_"> ../test/t3.out.2.json
 jsonlint -v ../test/t3.out.2.json
@@ -32,7 +35,62 @@ jsonlint -v ../test/t3.out.2.json
 ./bingram -i ../test/t3 > ../test/t3.out.3.json
 jsonlint -v ../test/t3.out.3.json
 
-
+./bingram -m 75% ../test/t3 | grep -v "Keeping"> ../test/t3.out.4.json
+jsonlint -v ../test/t3.out.4.json
+$check_json ../test/t3.out.4.json table-has 5878 sup=3 || exit 1
+$check_json ../test/t3.out.4.json table-lacks 165878 || exit 1
+$check_json ../test/t3.out.4.json minsup 3 || exit 1
+
+./bingram -r 3 ../test/t3 | grep -v "Sampling"> ../test/t3.out.5.json
+jsonlint -v ../test/t3.out.5.json
+$check_json ../test/t3.out.5.json sample pairs 4 || exit 1
+
+./bingram -n 2 ../test/t3 | grep -v "Sampling"> ../test/t3.out.6.json
+jsonlint -v ../test/t3.out.6.json
+$check_json ../test/t3.out.6.json sample files 4 || exit 1
+
+./bingram -x ../test/t3 > ../test/t3.out.7.json
+jsonlint -v ../test/t3.out.7.json
+$check_json ../test/t3.out.7.json occur ../test/t3 || exit 1
+
+
+echo "Running test4.."
+./bingram -g 3 -x ../test/t4 | grep -v "Using"> ../test/t4.out.1.json
+jsonlint -v ../test/t4.out.1.json
+./bingram -g 3 ../test/t4 | grep -v "Using"> ../test/t4.out.2.json
+jsonlint -v ../test/t4.out.2.json
+# ABC repeats in both files, -x must still keep one maximal copy of it
+$check_json ../test/t4.out.1.json table-has 414243 || exit 1
+$check_json ../test/t4.out.1.json covers ../test/t4.out.2.json || exit 1
+
+
+echo "Running test5.."
+./bingram -g 2 -x ../test/t5 | grep -v "Using"> ../test/t5.out.1.json
+jsonlint -v ../test/t5.out.1.json
+# BC repeats inside BBC, -x must only report the longer gram
+$check_json ../test/t5.out.1.json maximal || exit 1
+$check_json ../test/t5.out.1.json occur ../test/t5 || exit 1
+
+
+echo "Running test6.."
+./bingram ../test/t6 > ../test/t6.out.1.json
+jsonlint -v ../test/t6.out.1.json
+# short matches between the files must not add up to a gram none of them holds
+$check_json ../test/t6.out.1.json occur ../test/t6 || exit 1
+./bingram -g 3 ../test/t6 | grep -v "Using"> ../test/t6.out.2.json
+jsonlint -v ../test/t6.out.2.json
+$check_json ../test/t6.out.2.json occur ../test/t6 || exit 1
+
+
+echo "Running test7.."
+./bingram -g 3 -x ../test/t7 | grep -v "Using"> ../test/t7.out.1.json
+jsonlint -v ../test/t7.out.1.json
+./bingram -g 3 ../test/t7 | grep -v "Using"> ../test/t7.out.2.json
+jsonlint -v ../test/t7.out.2.json
+# ABC is the only match, its copies all tie and one of them must be kept
+$check_json ../test/t7.out.1.json table-has 414243 || exit 1
+$check_json ../test/t7.out.1.json covers ../test/t7.out.2.json || exit 1
+$check_json ../test/t7.out.1.json maximal || exit 1
 
 
 echo "Done"